@@ -0,0 +1,231 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+
+
+#ifndef INDEPENDENCY_POOL_HPP
+#define INDEPENDENCY_POOL_HPP
+
+#if __cplusplus < 201103L && !(defined(_MSC_VER) && _MSC_VER >= 1900)
+#error "boost/independency/pool.hpp requires C++11 threads"
+#endif
+
+#include <boost/independency.hpp>
+#include <boost/independency/queue.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace boost { namespace independency {
+
+/// \brief Worker threads running the Startup stages in background.
+/// \details The stages are launched on the bus thread as usual, the Task's
+///          init only hands its work to the pool and returns. The workers
+///          run the work and put the finished tasks to the Queue, and the
+///          bus thread publishes their readiness with Pool::run or
+///          Pool::poll, so the readiness is sent on the thread that owns
+///          the bus. Stages of other kinds may be added to the same Startup.
+/// \tparam W Number of the worker threads.
+/// \tparam N Capacity of the queue of the finished tasks, the workers wait
+///           while it is full.
+template <std::size_t W, std::size_t N = 64>
+class Pool
+{
+    public:
+    /// \brief The stage run by the pool.
+    /// \details Add it to the Startup the same as Stage.
+    class Task : public Stage
+    {
+        public:
+        /// \brief Constructor.
+        /// \param pool  Pool to run the work on.
+        /// \param id    Identifier published when the work is done.
+        /// \param deps  Identifiers the stage waits for, may be null.
+        /// \param count Number of the dependencies.
+        /// \param arg   Will be passed to the callback.
+        /// \param work  Callback, the initialization itself. Called on a
+        ///              worker thread, must not touch the bus.
+        Task(Pool& pool, unsigned long id, const unsigned long* deps,
+             std::size_t count, void* arg, void (*work)(void* arg))
+        : Stage(id, deps, count, reinterpret_cast<void*>(this), launch),
+          pool(pool),
+          queued(static_cast<Task*>(0)),
+          data(arg),
+          work(work)
+        { }
+
+        private:
+        friend class Pool;
+
+        static bool launch(void* arg)
+        {
+            Task* that = reinterpret_cast<Task*>(arg);
+            that->pool.enqueue(*that);
+            return false;
+        }
+
+        Pool& pool;
+        Task* queued;
+        void* data;
+        void (*work)(void* arg);
+    };
+
+    /// \brief Constructor, starts the workers.
+    /// \param startup Startup to publish the readiness through.
+    /// \param wait    How Pool::run waits for the workers.
+    explicit Pool(Startup& startup, Wait wait = Wait())
+    : startup(startup),
+      finished(wait),
+      first(static_cast<Task*>(0)),
+      last(static_cast<Task*>(0)),
+      stopping(false),
+      running(0),
+      alive(W)
+    {
+        for (std::size_t i = 0; i < W; ++i)
+        {
+            workers[i] = std::thread(&Pool::serve, this);
+        }
+    }
+
+    /// \brief Destructor, waits for the works in progress.
+    /// \details The tasks not taken by the workers yet are dropped, and
+    ///          the readiness of the finished ones is not published.
+    ~Pool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            first = static_cast<Task*>(0);
+            last = static_cast<Task*>(0);
+        }
+        pending.notify_all();
+
+        // The worker may wait for the room in the full queue.
+        Task* task;
+        while (alive.load() != 0)
+        {
+            if (!finished.try_pop(task)) { std::this_thread::yield(); }
+        }
+        for (std::size_t i = 0; i < W; ++i) { workers[i].join(); }
+    }
+
+    /// \brief Publishes the readiness of the finished tasks, never waits.
+    /// \details Call it on the bus thread, for example from the event loop.
+    ///          The readiness launches the dependants, so their tasks are
+    ///          queued from here too.
+    /// \return Number of the published tasks.
+    std::size_t poll()
+    {
+        std::size_t published = 0;
+        Task* task;
+        while (finished.try_pop(task))
+        {
+            --running;
+            ++published;
+            startup.ready(task->identifier());
+        }
+        return published;
+    }
+
+    /// \brief Publishes the readiness until no task is left in the pool.
+    /// \details Call it on the bus thread after Startup::start. Waits with
+    ///          the pool's strategy. The stages reported by other threads
+    ///          are not waited for.
+    /// \return True if the startup is complete.
+    bool run()
+    {
+        Task* task;
+        while (running != 0 && finished.pop(task))
+        {
+            --running;
+            startup.ready(task->identifier());
+        }
+        return startup.complete();
+    }
+
+    private:
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+    // Called from Startup on the bus thread, the only one that counts.
+    void enqueue(Task& task)
+    {
+        ++running;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            task.queued = static_cast<Task*>(0);
+            if (first == static_cast<Task*>(0)) { first = &task; }
+            else { last->queued = &task; }
+            last = &task;
+        }
+        pending.notify_one();
+    }
+
+    void serve()
+    {
+        for (;;)
+        {
+            Task* task;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while (first == static_cast<Task*>(0) && !stopping)
+                {
+                    pending.wait(guard);
+                }
+                if (first == static_cast<Task*>(0)) { break; }
+
+                task = first;
+                first = task->queued;
+                if (first == static_cast<Task*>(0))
+                {
+                    last = static_cast<Task*>(0);
+                }
+            }
+
+            task->work(task->data);
+            finished.push(task);
+        }
+        alive.fetch_sub(1);
+    }
+
+    Startup& startup;
+    Queue<Task*, N> finished;
+    std::mutex lock;
+    std::condition_variable pending;
+    Task* first;
+    Task* last;
+    bool stopping;
+    std::size_t running;
+    std::atomic<std::size_t> alive;
+    std::thread workers[W];
+};
+
+}} // namespace boost::independency
+
+#endif // INDEPENDENCY_POOL_HPP
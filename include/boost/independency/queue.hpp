@@ -0,0 +1,228 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+
+#ifndef INDEPENDENCY_QUEUE_HPP
+#define INDEPENDENCY_QUEUE_HPP
+
+#if __cplusplus < 201103L && !(defined(_MSC_VER) && _MSC_VER >= 1900)
+#error "boost/independency/queue.hpp requires C++11 threads"
+#endif
+
+#include <boost/independency.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace boost { namespace independency {
+
+/// \brief How the consumer threads wait for the empty queue.
+/// \details Spinning gives the lowest wakeup latency only while the consumer
+///          has the core of its own, sleeping costs the wakeup through the
+///          kernel but leaves the core to the other threads.
+class Wait
+{
+    public:
+    enum Mode
+    {
+        spin,   ///< Busy loop with the pause instruction, never sleeps.
+        yield,  ///< Spins a while, then yields the core on every check.
+        futex,  ///< Spins a while, then sleeps until the producer wakes it.
+        block   ///< Sleeps right away, the lowest CPU use.
+    };
+
+    /// \brief Constructor.
+    /// \param mode  The strategy.
+    /// \param spins Checks before yield and futex stop spinning.
+    explicit Wait(Mode mode = futex, unsigned long spins = 1000)
+    : how(mode),
+      limit(spins)
+    { }
+
+    /// \brief The strategy.
+    Mode mode() const { return how; }
+
+    /// \brief Checks before yield and futex stop spinning.
+    unsigned long spins() const { return limit; }
+
+    private:
+    Mode how;
+    unsigned long limit;
+};
+
+/// \brief Bounded queue drained by the consumer threads.
+/// \details Moves the delivery off the producer's thread: producers push
+///          the items describing the messages, the consumers pop them and
+///          send the messages to their bus. The items are copied, since the
+///          message itself refers to the sender's temporary pairs. Each
+///          queue waits with its own strategy, so the latency-critical and
+///          the background consumers may wait differently. Any number of
+///          threads may push and pop, each item is popped by one of them;
+///          with several consumers the items of one producer may reach the
+///          bus out of order, since the consumers race to send them.
+/// \tparam T Item type, copyable.
+/// \tparam N Capacity in items.
+template <typename T, std::size_t N>
+class Queue
+{
+    public:
+    /// \brief Constructor.
+    /// \param wait How the consumers wait for the empty queue.
+    explicit Queue(Wait wait = Wait())
+    : wait(wait),
+      head(0),
+      count(0),
+      size(0),
+      closed(false),
+      waiters(0)
+    { }
+
+    /// \brief Puts the item to the queue.
+    /// \details Yields the core while the queue is full.
+    /// \param item Reference to the item, copied.
+    void push(const T& item)
+    {
+        for (;;)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (count == N)
+            {
+                guard.unlock();
+                std::this_thread::yield();
+                continue;
+            }
+
+            ring[(head + count) % N] = item;
+            ++count;
+            size.fetch_add(1, std::memory_order_release);
+            bool wake = waiters != 0;
+            guard.unlock();
+
+            if (wake) { ready.notify_one(); }
+            return;
+        }
+    }
+
+    /// \brief Takes the oldest item, waiting with the queue's strategy.
+    /// \param item Destination.
+    /// \return False if the queue is closed and drained.
+    bool pop(T& item)
+    {
+        for (unsigned long i = 0;; ++i)
+        {
+            if (size.load(std::memory_order_acquire) != 0)
+            {
+                // Another consumer may have taken the last item between the
+                // check and the lock.
+                std::lock_guard<std::mutex> guard(lock);
+                if (count == 0) { continue; }
+                take(item);
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire)) { return false; }
+
+            Wait::Mode mode = wait.mode();
+            if (mode == Wait::spin ||
+                (mode != Wait::block && i < wait.spins()))
+            {
+                pause();
+            }
+            else if (mode == Wait::yield)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ++waiters;
+                while (count == 0 && !closed.load()) { ready.wait(guard); }
+                --waiters;
+                i = 0;
+            }
+        }
+    }
+
+    /// \brief Takes the oldest item if there is one, never waits.
+    /// \param item Destination.
+    /// \return False if the queue is empty.
+    bool try_pop(T& item)
+    {
+        if (size.load(std::memory_order_acquire) == 0) { return false; }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (count == 0) { return false; }
+        take(item);
+        return true;
+    }
+
+    /// \brief Wakes the consumers, pop fails after the rest is drained.
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed.store(true, std::memory_order_release);
+        ready.notify_all();
+    }
+
+    private:
+    Queue(const Queue&);
+    Queue& operator=(const Queue&);
+
+    // Called under the lock with the nonempty queue.
+    void take(T& item)
+    {
+        item = ring[head];
+        head = (head + 1) % N;
+        --count;
+        size.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static void pause()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    T ring[N];
+    Wait wait;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::size_t head;
+    std::size_t count;
+    std::atomic<std::size_t> size;
+    std::atomic<bool> closed;
+    std::size_t waiters;
+};
+
+}} // namespace boost::independency
+
+#endif // INDEPENDENCY_QUEUE_HPP
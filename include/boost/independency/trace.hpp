@@ -0,0 +1,145 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+#ifndef INDEPENDENCY_TRACE_HPP
+#define INDEPENDENCY_TRACE_HPP
+
+#include <boost/independency.hpp>
+#include <cstdio>
+#include <stdint.h>
+
+namespace boost { namespace independency {
+
+/// \brief Timestamp of the trace event, 64 bits on every platform.
+typedef uint64_t Timestamp;
+
+/// \brief Tracer that keeps the last events in the fixed ring buffer.
+/// \details Attach it with Bus::trace. Recording takes a clock call and a
+///          few stores, the oldest events are overwritten when the buffer is
+///          full. Use one buffer per bus, the same as the bus itself it's
+///          not synchronized.
+/// \tparam N Capacity of the buffer in events.
+template <std::size_t N>
+class TraceBuffer : public Tracer
+{
+    public:
+    /// \brief Constructor.
+    /// \param clock Timestamp source, for example the CPU time stamp counter.
+    explicit TraceBuffer(Timestamp (*clock)())
+    : Tracer(reinterpret_cast<void*>(this), record),
+      clock(clock),
+      head(0),
+      count(0)
+    { }
+
+    /// \brief Number of the events in the buffer.
+    std::size_t size() const { return count; }
+
+    /// \brief Drops all of the recorded events.
+    void clear() { head = 0; count = 0; }
+
+    /// \brief Writes the events in the Chrome trace event format.
+    /// \details The file may be opened with chrome://tracing or Perfetto.
+    ///          Each send and each delivery is the nested slice, the slice
+    ///          arguments keep the send identifier and its parent. When
+    ///          the buffer is wrapped, the end events of the slices whose
+    ///          begin is overwritten are skipped.
+    /// \param file Destination file.
+    /// \param ticks_per_us Clock ticks in microsecond.
+    /// \return False if writing failed.
+    bool dump(std::FILE* file, double ticks_per_us = 1.0) const
+    {
+        static const char* const names[] = {
+            "send", "deliver", "deliver", "send"
+        };
+
+        if (std::fprintf(file, "{\"traceEvents\":[") < 0) { return false; }
+
+        std::size_t first = (head + N - count) % N;
+        std::size_t depth = 0;
+        bool separate = false;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const Record& r = records[(first + i) % N];
+            bool begin = r.event == Tracer::send || r.event == Tracer::deliver;
+
+            if (begin) { ++depth; }
+            else if (depth == 0) { continue; }
+            else { --depth; }
+
+            if (std::fprintf(file,
+                    "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":1,"
+                    "\"ts\":%.3f,\"args\":{\"id\":%lu,\"parent\":%lu,"
+                    "\"handler\":\"%p\"}}",
+                    separate ? "," : "", names[r.event], begin ? 'B' : 'E',
+                    static_cast<double>(r.timestamp) / ticks_per_us,
+                    r.id, r.parent, r.handler) < 0)
+            {
+                return false;
+            }
+            separate = true;
+        }
+
+        return std::fprintf(file, "\n]}\n") >= 0;
+    }
+
+    private:
+    struct Record
+    {
+        Timestamp timestamp;
+        unsigned long id;
+        unsigned long parent;
+        const void* handler;
+        Tracer::Event event;
+    };
+
+    static void record(void* arg, Tracer::Event event, unsigned long id,
+                       unsigned long parent, const Handler* handler,
+                       const Message&)
+    {
+        TraceBuffer* that = reinterpret_cast<TraceBuffer*>(arg);
+
+        Record& r = that->records[that->head];
+        r.timestamp = that->clock();
+        r.id = id;
+        r.parent = parent;
+        r.handler = handler;
+        r.event = event;
+
+        that->head = (that->head + 1) % N;
+        if (that->count < N) { ++that->count; }
+    }
+
+    Timestamp (*clock)();
+    Record records[N];
+    std::size_t head;
+    std::size_t count;
+};
+
+}} // namespace boost::independency
+
+#endif // INDEPENDENCY_TRACE_HPP
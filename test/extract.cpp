@@ -0,0 +1,121 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+
+// The benchmark of the single-pass extraction against the get_* calls on
+// the long message. Run it in the release build:
+//
+//     independency_extract fields=40 bindings=6 rounds=1000000
+
+#include <boost/independency.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace boost::independency;
+
+static unsigned long argument(int argc, char** argv, const char* name,
+                              unsigned long value)
+{
+    std::size_t len = std::strlen(name);
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], name, len) == 0 && argv[i][len] == '=')
+        {
+            value = std::strtoul(argv[i] + len + 1, 0, 10);
+        }
+    }
+    return value;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point begin,
+                      unsigned long rounds)
+{
+    std::chrono::duration<double, std::nano> d =
+        std::chrono::steady_clock::now() - begin;
+    return d.count() / rounds;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long fields = argument(argc, argv, "fields", 40);
+    unsigned long count = argument(argc, argv, "bindings", 6);
+    unsigned long rounds = argument(argc, argv, "rounds", 1000000);
+    if (fields == 0 || count == 0 || count > fields) { return -1; }
+
+    // The keys are spread over the message, the last one is at the end.
+    std::vector<Pair> pairs;
+    pairs.reserve(fields);
+    for (unsigned long i = 0; i < fields; ++i)
+    {
+        pairs.push_back(Pair(i + 1, static_cast<int>(i + 1)));
+    }
+    Message msg(pairs[0]);
+    for (unsigned long i = 1; i < fields; ++i) { msg.add(pairs[i]); }
+
+    std::vector<unsigned long> keys;
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        keys.push_back(fields - i * (fields / count));
+    }
+
+    std::vector<int> values(count);
+    std::vector<Binding> bindings;
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        bindings.push_back(Binding(keys[i], &values[i]));
+    }
+
+    volatile long sink = 0;
+
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    for (unsigned long r = 0; r < rounds; ++r)
+    {
+        for (unsigned long i = 0; i < count; ++i)
+        {
+            sink = sink + msg.get_int(keys[i]);
+        }
+    }
+    double get = elapsed(begin, rounds);
+
+    begin = std::chrono::steady_clock::now();
+    for (unsigned long r = 0; r < rounds; ++r)
+    {
+        msg.extract(&bindings[0], count);
+        sink = sink + values[count - 1];
+    }
+    double extract = elapsed(begin, rounds);
+
+    std::printf("fields %lu, bindings %lu\n", fields, count);
+    std::printf("get_*:   %.1f ns\n", get);
+    std::printf("extract: %.1f ns, %.1fx\n", extract, get / extract);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+
+
+// The check of the startup on the worker pool: the independent slow stages
+// run simultaneously on the workers, the readiness comes back to the main
+// thread, and the dependants are launched after it in order.
+
+#include <boost/independency.hpp>
+#include <boost/independency/pool.hpp>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace boost::independency;
+
+struct module
+{
+    std::thread::id thread;
+    unsigned long delay;
+};
+
+static void init(void* arg)
+{
+    module* that = reinterpret_cast<module*>(arg);
+    std::this_thread::sleep_for(std::chrono::milliseconds(that->delay));
+    that->thread = std::this_thread::get_id();
+}
+
+int main()
+{
+    typedef Pool<4> pool;
+
+    Bus bus;
+    Startup startup(bus, 100);
+    pool workers(startup, Wait(Wait::block));
+
+    const unsigned long after_slow[] = { 1, 2, 3 };
+    const unsigned long after_fourth[] = { 4 };
+
+    module modules[5] = {
+        { std::thread::id(), 100 },
+        { std::thread::id(), 100 },
+        { std::thread::id(), 100 },
+        { std::thread::id(), 0 },
+        { std::thread::id(), 0 }
+    };
+
+    pool::Task first(workers, 1, 0, 0, &modules[0], init);
+    pool::Task second(workers, 2, 0, 0, &modules[1], init);
+    pool::Task third(workers, 3, 0, 0, &modules[2], init);
+    pool::Task fourth(workers, 4, after_slow, 3, &modules[3], init);
+    pool::Task fifth(workers, 5, after_fourth, 1, &modules[4], init);
+
+    bus.reg(startup);
+    startup.add(first);
+    startup.add(second);
+    startup.add(third);
+    startup.add(fourth);
+
+    std::chrono::steady_clock::time_point begin =
+        std::chrono::steady_clock::now();
+    startup.start();
+
+    if (fourth.launched() || startup.complete())
+    {
+        std::printf("pool launch test failed\n");
+        return -1;
+    }
+
+    // Three stages of 100 ms each on four workers take about 100 ms.
+    bool complete = workers.run();
+    long elapsed = static_cast<long>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - begin).count());
+
+    if (!complete || elapsed >= 250)
+    {
+        std::printf("pool run test failed, %ld ms\n", elapsed);
+        return -1;
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (modules[i].thread == std::thread::id() ||
+            modules[i].thread == std::this_thread::get_id())
+        {
+            std::printf("pool thread test failed\n");
+            return -1;
+        }
+    }
+
+    // Added after the start, its dependency is ready, so the task is
+    // queued right away and published by poll.
+    startup.add(fifth);
+    while (!fifth.ready()) { workers.poll(); std::this_thread::yield(); }
+
+    if (!startup.complete() || workers.poll() != 0)
+    {
+        std::printf("pool late add test failed\n");
+        return -1;
+    }
+
+    std::printf("pool test passed in %ld ms\n", elapsed);
+    return 0;
+}
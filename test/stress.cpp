@@ -0,0 +1,483 @@
+/* © Copyright Artem Shapovalov 2025
+ * Distrubutes under the:
+ *
+ * Boost Software Licence - Version 1.0 - August 17th, 2003
+ *
+ * Permission is hereby granted, free of charge, to any person or organization
+ * obtaining a copy of the software and accompanying documentation covered by
+ * this license (the "Software") to use, reproduce, display, distribute,
+ * execute, and transmit the Software, and to prepare derivative works of the
+ * Software, and to permit third-parties to whom the Software is furnished
+ * to do so, all subject to the following:
+ *
+ * The copyright notices in the Software and this entire statement, including
+ * the above license grant, this restriction and the following disclaimer,
+ * must be included in all copies of the Software, in whole or in part,
+ * and all derivative works of the Software, unless such copies or derivative
+ * works are solely in the form of machine-executable object code generated
+ * by a source language processor.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, TITLE AND NON-INFRINGEMENT. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDERS OR ANYONE DISTRIBUTING THE SOFTWARE BE LIABLE
+ * FOR ANY DAMAGES OR OTHER LIABILITY, WHETHER IN CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+
+// The stress harness for the bus under the multi-threaded load. The sends
+// are made by one thread at a time, so the producers serialize them with
+// the mutex, while the registrars register and unregister the handlers
+// without it. The handler called after its unregistration returned counts
+// as the stray delivery. With sticky=1 the bus keeps the last message, so
+// the handlers registered by the registrars receive it before the next
+// one. Run it with the arguments in form name=value, for example:
+//
+//     independency_stress producers=4 consumers=8 messages=100000 work=50
+//
+// The interval argument paces every producer, one message per the given
+// number of nanoseconds, to measure latency below the saturation.
+//
+// With mode=queued the producers don't send themselves, they put messages to
+// the library's Queue drained by the dispatcher threads, the usual way to
+// move the delivery off the producer's thread. The dispatchers argument sets
+// their number; with more than one the messages of a producer may reach the
+// bus out of order, so the reordering is reported but not failed, and only
+// the counted consumers are checked for the lost and duplicated messages.
+// The wait argument selects the Wait strategy of the dispatchers for the
+// empty queue:
+//
+//     spin  - busy loop with the pause instruction, the lowest latency
+//     yield - spins a while, then gives the core to the other threads
+//     futex - spins a while, then sleeps until the producer wakes it up
+//     block - sleeps on the condition variable right away, the lowest CPU
+//
+// Build it with "b2 thread-sanitizer=on" to check the locking discipline.
+
+#include <boost/independency.hpp>
+#include <boost/independency/queue.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace boost::independency;
+
+#define PRODUCER_KEY  1
+#define SEQUENCE_KEY  2
+#define TIMESTAMP_KEY 3
+#define PADDING_KEY   4
+
+struct config
+{
+    unsigned long producers;
+    unsigned long consumers;
+    unsigned long messages;
+    unsigned long fields;
+    unsigned long work;
+    unsigned long registrars;
+    unsigned long interval;
+    unsigned long dispatchers;
+    unsigned long sticky;
+    const char* mode;
+    const char* wait;
+};
+
+struct item
+{
+    unsigned long producer;
+    unsigned long sequence;
+    unsigned long timestamp;
+};
+
+static unsigned long now()
+{
+    return static_cast<unsigned long>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static void pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+static void burn(unsigned long work)
+{
+    volatile unsigned long sink = 0;
+    for (unsigned long i = 0; i < work; ++i) { sink = sink + i; }
+}
+
+class consumer : public Handler
+{
+    public:
+    consumer(const config& cfg, bool counted)
+    : Handler(reinterpret_cast<void*>(this), hnd),
+      cfg(cfg),
+      counted(counted),
+      last(cfg.producers, 0),
+      seen(cfg.producers, false),
+      active(counted),
+      received(0),
+      lost(0),
+      reordered(0),
+      stray(0)
+    {
+        if (counted) { latencies.reserve(cfg.producers * cfg.messages); }
+    }
+
+    static void hnd(void* arg, const Message& msg)
+    {
+        consumer* that = reinterpret_cast<consumer*>(arg);
+        if (!that->active.load()) { ++that->stray; }
+
+        unsigned long producer, sequence, timestamp;
+        Binding fields[] = {
+            Binding(PRODUCER_KEY,  &producer),
+            Binding(SEQUENCE_KEY,  &sequence),
+            Binding(TIMESTAMP_KEY, &timestamp)
+        };
+        if (msg.extract(fields, 3) != 3 || producer >= that->cfg.producers)
+        {
+            return;
+        }
+
+        burn(that->cfg.work);
+
+        // Consumers registered during the run start from any message, so
+        // only the gaps after the first one count for them.
+        if (!that->seen[producer] && !that->counted)
+        {
+            that->seen[producer] = true;
+        }
+        else if (sequence > that->last[producer] + 1)
+        {
+            that->lost += sequence - that->last[producer] - 1;
+        }
+        else if (sequence <= that->last[producer])
+        {
+            ++that->reordered;
+        }
+
+        that->seen[producer] = true;
+        that->last[producer] = std::max(that->last[producer], sequence);
+        ++that->received;
+
+        if (that->counted) { that->latencies.push_back(now() - timestamp); }
+    }
+
+    const config& cfg;
+    bool counted;
+    std::vector<unsigned long> last;
+    std::vector<bool> seen;
+    std::vector<unsigned long> latencies;
+    std::atomic<bool> active;
+    unsigned long received;
+    unsigned long lost;
+    unsigned long reordered;
+    unsigned long stray;
+};
+
+class padding
+{
+    public:
+    explicit padding(unsigned long fields)
+    {
+        pairs.reserve(fields);
+        for (unsigned long i = 0; i < fields; ++i)
+        {
+            pairs.push_back(Pair(PADDING_KEY + i, static_cast<int>(i)));
+        }
+    }
+
+    void send(Bus& bus, std::mutex& lock, const item& it)
+    {
+        Pair producer_pair(PRODUCER_KEY, it.producer);
+        Pair sequence_pair(SEQUENCE_KEY, it.sequence);
+        Pair timestamp_pair(TIMESTAMP_KEY, it.timestamp);
+
+        Message msg(producer_pair);
+        msg.add(sequence_pair).add(timestamp_pair);
+        for (std::size_t i = 0; i < pairs.size(); ++i) { msg.add(pairs[i]); }
+
+        std::lock_guard<std::mutex> guard(lock);
+        bus.send(msg);
+    }
+
+    private:
+    std::vector<Pair> pairs;
+};
+
+static void produce(Bus& bus, std::mutex& lock, Queue<item, 1024>* q,
+                    const config& cfg, unsigned long producer)
+{
+    padding pad(cfg.fields);
+
+    unsigned long next = now();
+    for (unsigned long seq = 1; seq <= cfg.messages; ++seq)
+    {
+        if (cfg.interval != 0)
+        {
+            while (now() < next) { pause(); }
+            next += cfg.interval;
+        }
+
+        item it = { producer, seq, now() };
+        if (q != 0) { q->push(it); }
+        else { pad.send(bus, lock, it); }
+    }
+}
+
+static void dispatch(Bus& bus, std::mutex& lock, Queue<item, 1024>& q,
+                     const config& cfg)
+{
+    padding pad(cfg.fields);
+
+    item it;
+    while (q.pop(it)) { pad.send(bus, lock, it); }
+}
+
+// Keeps the window of the late consumers subscribed until the producers
+// finish: each step registers the next one and unregisters the oldest one.
+// The consumer is touched here only while unregistered, so the bus must be
+// done with it once unreg returns.
+static void subscribe(Bus& bus, std::vector<consumer*>& late,
+                      std::atomic<bool>& stop)
+{
+    static const std::size_t window = 8;
+
+    for (std::size_t step = 0; !stop.load(); ++step)
+    {
+        consumer* next = late[step % late.size()];
+        std::fill(next->seen.begin(), next->seen.end(), false);
+        next->active.store(true);
+        bus.reg(*next);
+
+        if (step >= window)
+        {
+            consumer* old = late[(step - window) % late.size()];
+            bus.unreg(*old);
+            old->active.store(false);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+static unsigned long percentile(const std::vector<unsigned long>& sorted,
+                                double p)
+{
+    if (sorted.empty()) { return 0; }
+    std::size_t index = static_cast<std::size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static bool parse(int argc, char** argv, config& cfg)
+{
+    struct option
+    {
+        const char* name;
+        unsigned long* value;
+        const char** text;
+    };
+    option options[] = {
+        { "producers",  &cfg.producers,  0 },
+        { "consumers",  &cfg.consumers,  0 },
+        { "messages",   &cfg.messages,   0 },
+        { "fields",     &cfg.fields,     0 },
+        { "work",       &cfg.work,       0 },
+        { "registrars", &cfg.registrars, 0 },
+        { "interval",   &cfg.interval,   0 },
+        { "dispatchers", &cfg.dispatchers, 0 },
+        { "sticky",     &cfg.sticky,     0 },
+        { "mode",       0,               &cfg.mode },
+        { "wait",       0,               &cfg.wait }
+    };
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* eq = std::strchr(argv[i], '=');
+        bool known = false;
+        std::size_t count = sizeof(options) / sizeof(options[0]);
+        for (std::size_t j = 0; eq != 0 && j < count; ++j)
+        {
+            std::size_t len = std::strlen(options[j].name);
+            if (static_cast<std::size_t>(eq - argv[i]) != len ||
+                std::strncmp(argv[i], options[j].name, len) != 0)
+            {
+                continue;
+            }
+
+            if (options[j].value != 0)
+            {
+                *options[j].value = std::strtoul(eq + 1, 0, 10);
+            }
+            else { *options[j].text = eq + 1; }
+            known = true;
+        }
+
+        if (!known)
+        {
+            std::printf("unknown argument: %s\n", argv[i]);
+            return false;
+        }
+    }
+    return cfg.producers != 0 && cfg.dispatchers != 0;
+}
+
+static bool strategy(const char* name, Wait::Mode& wait)
+{
+    static const char* const names[] = { "spin", "yield", "futex", "block" };
+    for (int i = 0; i < 4; ++i)
+    {
+        if (std::strcmp(name, names[i]) == 0)
+        {
+            wait = static_cast<Wait::Mode>(i);
+            return true;
+        }
+    }
+    std::printf("unknown wait strategy: %s\n", name);
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    config cfg = { 4, 4, 20000, 8, 0, 1, 0, 1, 0, "direct", "futex" };
+    if (!parse(argc, argv, cfg)) { return -1; }
+
+    Wait::Mode wait;
+    if (!strategy(cfg.wait, wait)) { return -1; }
+
+    bool queued = std::strcmp(cfg.mode, "queued") == 0;
+    if (!queued && std::strcmp(cfg.mode, "direct") != 0)
+    {
+        std::printf("unknown mode: %s\n", cfg.mode);
+        return -1;
+    }
+
+    Bus bus;
+    std::mutex lock;
+    std::atomic<bool> stop(false);
+
+    StickyMessage<16> last(PRODUCER_KEY);
+    if (cfg.sticky != 0) { bus.stick(last); }
+
+    std::vector<consumer*> consumers;
+    for (unsigned long i = 0; i < cfg.consumers; ++i)
+    {
+        consumers.push_back(new consumer(cfg, true));
+        bus.reg(*consumers.back());
+    }
+
+    std::vector<consumer*> late;
+    for (unsigned long i = 0; i < cfg.registrars * 16; ++i)
+    {
+        late.push_back(new consumer(cfg, false));
+    }
+
+    Queue<item, 1024> q((Wait(wait)));
+    unsigned long begin = now();
+    std::clock_t cpu = std::clock();
+
+    std::vector<std::thread> threads;
+    for (unsigned long i = 0; i < cfg.registrars; ++i)
+    {
+        std::vector<consumer*>* part = new std::vector<consumer*>(
+            late.begin() + i * 16, late.begin() + (i + 1) * 16);
+        threads.push_back(std::thread([&bus, part, &stop]() {
+            subscribe(bus, *part, stop);
+            delete part;
+        }));
+    }
+    std::vector<std::thread> dispatchers;
+    for (unsigned long i = 0; queued && i < cfg.dispatchers; ++i)
+    {
+        dispatchers.push_back(std::thread(dispatch, std::ref(bus),
+                                          std::ref(lock), std::ref(q),
+                                          std::cref(cfg)));
+    }
+    for (unsigned long i = 0; i < cfg.producers; ++i)
+    {
+        threads.push_back(std::thread(produce, std::ref(bus), std::ref(lock),
+                                      queued ? &q : 0, std::cref(cfg), i));
+    }
+
+    for (std::size_t i = cfg.registrars; i < threads.size(); ++i)
+    {
+        threads[i].join();
+    }
+    if (queued)
+    {
+        q.close();
+        for (std::size_t i = 0; i < dispatchers.size(); ++i)
+        {
+            dispatchers[i].join();
+        }
+    }
+    stop.store(true);
+    for (std::size_t i = 0; i < cfg.registrars; ++i) { threads[i].join(); }
+
+    unsigned long elapsed = now() - begin;
+    double cpu_seconds = static_cast<double>(std::clock() - cpu) /
+                         CLOCKS_PER_SEC;
+
+    std::vector<unsigned long> latencies;
+    unsigned long lost = 0, duplicated = 0, reordered = 0, deliveries = 0;
+    unsigned long stray = 0;
+    bool ordered = !queued || cfg.dispatchers == 1;
+    for (std::size_t i = 0; i < consumers.size(); ++i)
+    {
+        consumer* c = consumers[i];
+        latencies.insert(latencies.end(), c->latencies.begin(),
+                         c->latencies.end());
+        unsigned long expected = cfg.producers * cfg.messages;
+        lost += c->received < expected ? expected - c->received : 0;
+        duplicated += c->received > expected ? c->received - expected : 0;
+        reordered += c->reordered;
+        deliveries += c->received;
+    }
+    for (std::size_t i = 0; i < late.size(); ++i)
+    {
+        // The gaps of the late consumers mean the loss only in order.
+        if (ordered) { lost += late[i]->lost; }
+        reordered += late[i]->reordered;
+        deliveries += late[i]->received;
+        stray += late[i]->stray;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    double seconds = static_cast<double>(elapsed) / 1e9;
+    unsigned long sent = cfg.producers * cfg.messages;
+
+    std::printf("producers %lu, consumers %lu, registrars %lu, "
+                "fields %lu, work %lu, interval %lu, mode %s, wait %s, "
+                "dispatchers %lu, sticky %lu\n",
+                cfg.producers, cfg.consumers, cfg.registrars, cfg.fields,
+                cfg.work, cfg.interval, cfg.mode, queued ? cfg.wait : "-",
+                queued ? cfg.dispatchers : 0, cfg.sticky);
+    std::printf("messages:   %lu in %.3f s, %.0f msg/s, %.0f deliveries/s\n",
+                sent, seconds, sent / seconds, deliveries / seconds);
+    std::printf("latency ns: p50 %lu, p99 %lu, p99.9 %lu\n",
+                percentile(latencies, 0.5), percentile(latencies, 0.99),
+                percentile(latencies, 0.999));
+    std::printf("cpu:        %.3f s, %.0f%% of one core\n",
+                cpu_seconds, cpu_seconds / seconds * 100.0);
+    std::printf("duplicated %lu, stray %lu\n", duplicated, stray);
+    std::printf("lost %lu, reordered %lu\n", lost, reordered);
+
+    for (std::size_t i = 0; i < consumers.size(); ++i) { delete consumers[i]; }
+    for (std::size_t i = 0; i < late.size(); ++i) { delete late[i]; }
+
+    return lost == 0 && duplicated == 0 && stray == 0 &&
+           (reordered == 0 || !ordered) ? 0 : -1;
+}
@@ -25,11 +25,21 @@
  * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS IN THE SOFTWARE. */
 
+// The key test makes the collision on purpose.
+#define INDEPENDENCY_NO_KEY_CHECK
+
 #include <boost/independency.hpp>
+#include <boost/independency/trace.hpp>
 #include <cstdio>
+#include <cstring>
 
 using namespace boost::independency;
 
+#if __cplusplus >= 201103L
+static_assert(hash_key("vehicle.speed") != hash_key("vehicle.rpm"),
+              "named keys should be hashed at compile time");
+#endif
+
 class test_consumer : public Handler
 {
     public:
@@ -45,6 +55,182 @@ class test_consumer : public Handler
     int received;
 };
 
+class test_stage : public Stage
+{
+    public:
+    test_stage(unsigned long id, const unsigned long* deps, std::size_t count,
+               bool sync, unsigned long* log)
+    : Stage(id, deps, count, reinterpret_cast<void*>(this), init),
+      id(id), sync(sync), log(log)
+    {}
+
+    static bool init(void* arg)
+    {
+        test_stage* that = reinterpret_cast<test_stage*>(arg);
+        *that->log = *that->log * 10 + that->id;
+        return that->sync;
+    }
+
+    unsigned long id;
+    bool sync;
+    unsigned long* log;
+};
+
+class test_forwarder : public Handler
+{
+    public:
+    explicit test_forwarder(Bus& bus)
+    : Handler(reinterpret_cast<void*>(this), hnd), bus(bus)
+    {}
+
+    static void hnd(void* arg, const Message& mess)
+    {
+        test_forwarder* that = reinterpret_cast<test_forwarder*>(arg);
+        if (mess.get_int(1) == 1)
+        {
+            that->bus.send(Message(Pair(1, static_cast<int>(2))));
+        }
+    }
+
+    Bus& bus;
+};
+
+class test_tracer : public Tracer
+{
+    public:
+    test_tracer() : Tracer(reinterpret_cast<void*>(this), hnd), count(0)
+    {}
+
+    static void hnd(void* arg, Event event, unsigned long id,
+                    unsigned long parent, const Handler*, const Message&)
+    {
+        test_tracer* that = reinterpret_cast<test_tracer*>(arg);
+        if (that->count < 8)
+        {
+            that->events[that->count] = event;
+            that->ids[that->count] = id;
+            that->parents[that->count] = parent;
+        }
+        ++that->count;
+    }
+
+    Event events[8];
+    unsigned long ids[8];
+    unsigned long parents[8];
+    std::size_t count;
+};
+
+class test_counter : public Handler
+{
+    public:
+    test_counter() : Handler(reinterpret_cast<void*>(this), hnd), received(0)
+    {}
+
+    static void hnd(void* arg, const Message&)
+    {
+        ++reinterpret_cast<test_counter*>(arg)->received;
+    }
+
+    int received;
+};
+
+class test_remover : public Handler
+{
+    public:
+    explicit test_remover(Bus& bus)
+    : Handler(reinterpret_cast<void*>(this), hnd), bus(bus),
+      target(this), received(0)
+    {}
+
+    static void hnd(void* arg, const Message&)
+    {
+        test_remover* that = reinterpret_cast<test_remover*>(arg);
+        ++that->received;
+        that->bus.unreg(*that->target);
+    }
+
+    Bus& bus;
+    Handler* target;
+    int received;
+};
+
+class test_adder : public Handler
+{
+    public:
+    test_adder() : Handler(reinterpret_cast<void*>(this), hnd), sum(0)
+    {}
+
+    static void hnd(void* arg, const Message& mess)
+    {
+        reinterpret_cast<test_adder*>(arg)->sum += mess.get_int(1);
+    }
+
+    int sum;
+};
+
+class test_registrar : public Handler
+{
+    public:
+    test_registrar(Bus& bus, Handler& late, int trigger)
+    : Handler(reinterpret_cast<void*>(this), hnd),
+      bus(bus), late(late), trigger(trigger)
+    {}
+
+    static void hnd(void* arg, const Message& mess)
+    {
+        test_registrar* that = reinterpret_cast<test_registrar*>(arg);
+        if (mess.get_int(1) == that->trigger) { that->bus.reg(that->late); }
+    }
+
+    Bus& bus;
+    Handler& late;
+    int trigger;
+};
+
+class test_orderer : public Handler
+{
+    public:
+    test_orderer() : Handler(reinterpret_cast<void*>(this), hnd),
+      id(0), log(static_cast<int*>(0)), size(static_cast<std::size_t*>(0))
+    {}
+
+    static void hnd(void* arg, const Message&)
+    {
+        test_orderer* that = reinterpret_cast<test_orderer*>(arg);
+        that->log[(*that->size)++] = that->id;
+    }
+
+    int id;
+    int* log;
+    std::size_t* size;
+};
+
+class test_keeper : public Handler
+{
+    public:
+    test_keeper() : Handler(reinterpret_cast<void*>(this), hnd)
+    {}
+
+    static void hnd(void* arg, const Message& mess)
+    {
+        test_keeper* that = reinterpret_cast<test_keeper*>(arg);
+        that->kept = mess.get_payload(1);
+    }
+
+    Payload kept;
+};
+
+static void test_release(void* arg)
+{
+    ++*reinterpret_cast<int*>(arg);
+}
+
+static Timestamp test_clock()
+{
+    static Timestamp ticks = 0;
+    return ++ticks;
+}
+
 int main(int argc, char** argv)
 {
     {
@@ -150,6 +336,82 @@ int main(int argc, char** argv)
         }
     }
 
+    {
+        // This test checks the single-pass extraction: the found values,
+        // the type mismatch, the missing key and the shared key.
+
+        int event = -1;
+        float speed = -1.0f;
+        int init = -1;
+        double missing = -1.0;
+
+        Binding fields[] = {
+            Binding(1, &event),
+            Binding(2, &speed),
+            Binding(2, &init),
+            Binding(3, &missing)
+        };
+
+        Pair event_pair(1, static_cast<int>(2));
+        Pair speed_pair(2, static_cast<float>(40));
+        Pair duplicate_pair(2, static_cast<int>(5));
+
+        Message mess(event_pair);
+        mess.add(speed_pair).add(duplicate_pair);
+
+        if (mess.extract(fields, sizeof(fields) / sizeof(fields[0])) != 2 ||
+            event != 2 || speed != static_cast<float>(40) ||
+            !fields[0].extracted() || !fields[1].extracted())
+        {
+            std::printf("extract failed\n");
+            return -1;
+        }
+
+        if (init != 0 || !fields[2].found() || fields[2].extracted())
+        {
+            std::printf("extract type check failed\n");
+            return -1;
+        }
+
+        if (missing != 0.0 || fields[3].found())
+        {
+            std::printf("extract missing key failed\n");
+            return -1;
+        }
+
+        int values[40];
+        Binding many[40] = {
+            Binding(1, &values[0]), Binding(1, &values[1]),
+            Binding(1, &values[2]), Binding(1, &values[3]),
+            Binding(1, &values[4]), Binding(1, &values[5]),
+            Binding(1, &values[6]), Binding(1, &values[7]),
+            Binding(1, &values[8]), Binding(1, &values[9]),
+            Binding(1, &values[10]), Binding(1, &values[11]),
+            Binding(1, &values[12]), Binding(1, &values[13]),
+            Binding(1, &values[14]), Binding(1, &values[15]),
+            Binding(1, &values[16]), Binding(1, &values[17]),
+            Binding(1, &values[18]), Binding(1, &values[19]),
+            Binding(1, &values[20]), Binding(1, &values[21]),
+            Binding(1, &values[22]), Binding(1, &values[23]),
+            Binding(1, &values[24]), Binding(1, &values[25]),
+            Binding(1, &values[26]), Binding(1, &values[27]),
+            Binding(1, &values[28]), Binding(1, &values[29]),
+            Binding(1, &values[30]), Binding(1, &values[31]),
+            Binding(1, &values[32]), Binding(1, &values[33]),
+            Binding(2, &values[34]), Binding(1, &values[35]),
+            Binding(1, &values[36]), Binding(1, &values[37]),
+            Binding(3, &values[38]), Binding(1, &values[39])
+        };
+
+        if (mess.extract(many, 40) != 38 || values[0] != 2 ||
+            values[39] != 2 || values[34] != 0 || !many[34].found() ||
+            values[38] != 0 || many[38].found())
+        {
+            std::printf("extract overflow failed\n");
+            return -1;
+        }
+    }
+
     {
         // This test check the bus message propagation and building
 
@@ -166,5 +428,683 @@ int main(int argc, char** argv)
         }
     }
 
+    {
+        // This test checks the dependency-ordered startup: independent
+        // stages are launched together, the background one reports later
+        // and its dependants are launched after that in order.
+
+        Bus bus;
+        Startup startup(bus, 100);
+        unsigned long log = 0;
+
+        const unsigned long after_both[] = { 1, 2 };
+        const unsigned long after_third[] = { 3 };
+
+        const unsigned long* none = static_cast<const unsigned long*>(0);
+
+        test_stage first(1, none, 0, true, &log);
+        test_stage second(2, none, 0, false, &log);
+        test_stage third(3, after_both, 2, true, &log);
+        test_stage fourth(4, after_third, 1, true, &log);
+
+        bus.reg(startup);
+        startup.add(fourth);
+        startup.add(third);
+        startup.add(second);
+        startup.add(first);
+        startup.start();
+
+        if (log != 21 || !first.ready() || second.ready() || startup.complete())
+        {
+            std::printf("startup launch test failed\n");
+            return -1;
+        }
+
+        startup.ready(2);
+
+        if (log != 2134 || !fourth.ready() || !startup.complete())
+        {
+            std::printf("startup dependency test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the repeated and unknown readiness is ignored and
+        // the stages waiting for a missing stage or a cycle are reported.
+
+        Bus bus;
+        Startup startup(bus, 100);
+        unsigned long log = 0;
+
+        const unsigned long after_both[] = { 1, 2 };
+        const unsigned long after_missing[] = { 9 };
+        const unsigned long after_sixth[] = { 6 };
+        const unsigned long after_fifth[] = { 5 };
+
+        const unsigned long* none = static_cast<const unsigned long*>(0);
+
+        test_stage first(1, none, 0, false, &log);
+        test_stage second(2, none, 0, false, &log);
+        test_stage third(3, after_both, 2, true, &log);
+        test_stage fourth(4, after_missing, 1, true, &log);
+        test_stage fifth(5, after_sixth, 1, true, &log);
+        test_stage sixth(6, after_fifth, 1, true, &log);
+
+        bus.reg(startup);
+        startup.add(sixth);
+        startup.add(fifth);
+        startup.add(fourth);
+        startup.add(third);
+        startup.add(second);
+        startup.add(first);
+        startup.start();
+
+        startup.ready(1);
+        startup.ready(1);
+        startup.ready(9);
+
+        if (log != 21 || third.launched())
+        {
+            std::printf("startup duplicate test failed\n");
+            return -1;
+        }
+
+        const Stage* stuck[4];
+        std::size_t count = startup.stuck(stuck, 4);
+
+        if (count != 3 || stuck[0] != &sixth || stuck[1] != &fifth ||
+            stuck[2] != &fourth || startup.stuck(stuck, 0) != 3)
+        {
+            std::printf("startup stuck test failed\n");
+            return -1;
+        }
+
+        startup.ready(2);
+
+        if (log != 213 || !third.ready() || startup.complete())
+        {
+            std::printf("startup partial test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the stages added after the start: the one whose
+        // dependency is already ready is launched right away, the others
+        // wait as usual or are reported stuck.
+
+        Bus bus;
+        Startup startup(bus, 100);
+        unsigned long log = 0;
+
+        const unsigned long after_first[] = { 1 };
+        const unsigned long after_missing[] = { 9 };
+
+        const unsigned long* none = static_cast<const unsigned long*>(0);
+
+        test_stage first(1, none, 0, false, &log);
+        test_stage second(2, after_first, 1, true, &log);
+        test_stage third(3, after_first, 1, true, &log);
+        test_stage fourth(4, after_first, 1, true, &log);
+        test_stage fifth(5, after_missing, 1, true, &log);
+
+        bus.reg(startup);
+        startup.add(first);
+        startup.add(second);
+        startup.start();
+        startup.add(third);
+
+        const Stage* stuck[2];
+        if (log != 1 || third.launched() || startup.stuck(stuck, 2) != 0)
+        {
+            std::printf("startup late add test failed\n");
+            return -1;
+        }
+
+        startup.ready(1);
+        startup.add(fourth);
+        startup.add(fifth);
+
+        if (log != 1234 || !fourth.ready() || startup.complete() ||
+            startup.stuck(stuck, 2) != 1 || stuck[0] != &fifth)
+        {
+            std::printf("startup ready add test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the tracing of the nested send: the inner send
+        // refers to the outer one and all of the events are balanced.
+
+        Bus bus;
+        test_forwarder forwarder(bus);
+        test_tracer tracer;
+
+        bus.reg(forwarder);
+        bus.trace(&tracer);
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+
+        const Tracer::Event expected[] = {
+            Tracer::send, Tracer::deliver,
+            Tracer::send, Tracer::deliver, Tracer::returned, Tracer::sent,
+            Tracer::returned, Tracer::sent
+        };
+
+        if (tracer.count != 8)
+        {
+            std::printf("trace count test failed\n");
+            return -1;
+        }
+
+        for (std::size_t i = 0; i < 8; ++i)
+        {
+            bool inner = i >= 2 && i <= 5;
+            if (tracer.events[i] != expected[i] ||
+                tracer.ids[i] != (inner ? 2UL : 1UL) ||
+                tracer.parents[i] != (inner ? 1UL : 0UL))
+            {
+                std::printf("trace causality test failed\n");
+                return -1;
+            }
+        }
+
+        TraceBuffer<4> buffer(test_clock);
+        bus.trace(&buffer);
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+        bus.trace(static_cast<Tracer*>(0));
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+
+        if (buffer.size() != 4)
+        {
+            std::printf("trace buffer test failed\n");
+            return -1;
+        }
+
+        TraceBuffer<3> wrapped(test_clock);
+        test_counter counter;
+        Bus single;
+        single.reg(counter);
+        single.trace(&wrapped);
+        single.send(Message(Pair(1, static_cast<int>(1))));
+
+        char text[1024];
+        std::FILE* file = std::tmpfile();
+        std::size_t length = 0;
+        if (file != static_cast<std::FILE*>(0) && wrapped.dump(file))
+        {
+            std::rewind(file);
+            length = std::fread(text, 1, sizeof(text) - 1, file);
+            std::fclose(file);
+        }
+        text[length] = '\0';
+
+        const char* begin = std::strstr(text, "\"ph\":\"B\"");
+        const char* end = std::strstr(text, "\"ph\":\"E\"");
+        if (wrapped.size() != 3 || begin == static_cast<const char*>(0) ||
+            end == static_cast<const char*>(0) || end < begin ||
+            std::strstr(end + 1, "\"ph\":\"E\"") !=
+                static_cast<const char*>(0))
+        {
+            std::printf("trace wrap test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the payload sharing: the subscribers see the same
+        // buffer and it's released once after the last copy is dropped.
+
+        static const char frame[] = "frame";
+        int released = 0;
+        Owner owner(reinterpret_cast<void*>(&released), test_release);
+
+        Bus bus;
+        test_keeper first;
+        test_keeper second;
+        bus.reg(first);
+        bus.reg(second);
+
+        {
+            Payload payload(frame, sizeof(frame), &owner);
+            bus.send(Message(Pair(1, payload)));
+        }
+
+        if (released != 0 || first.kept.data() != frame ||
+            second.kept.data() != frame || second.kept.size() != sizeof(frame))
+        {
+            std::printf("payload sharing test failed\n");
+            return -1;
+        }
+
+        first.kept = Payload();
+        second.kept = Payload();
+
+        if (released != 1)
+        {
+            std::printf("payload release test failed\n");
+            return -1;
+        }
+
+        {
+            Payload late(frame, sizeof(frame), &owner);
+        }
+
+        if (released != 1)
+        {
+            std::printf("payload double release test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the content-based routing: the handlers share
+        // the conditions and receive only the messages matching all of them.
+
+        const Condition is_data(1, 2);
+        const Condition has_speed(2);
+        const Condition normal_speed(2, 0.0, 100.0);
+        const Condition low_gear(3, 1, 2);
+
+        const Condition* const data[] = { &is_data };
+        const Condition* const normal[] = { &is_data, &normal_speed };
+        const Condition* const geared[] = { &has_speed, &low_gear };
+
+        Bus bus;
+        test_counter any, all_data, normal_data, low_geared;
+        all_data.when(data, 1);
+        normal_data.when(normal, 2);
+        low_geared.when(geared, 2);
+        bus.reg(any);
+        bus.reg(all_data);
+        bus.reg(normal_data);
+        bus.reg(low_geared);
+
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+        bus.send(Message(Pair(1, static_cast<int>(2)))
+                    .add(Pair(2, static_cast<float>(40)))
+                    .add(Pair(3, static_cast<unsigned char>(2))));
+        bus.send(Message(Pair(1, static_cast<int>(2)))
+                    .add(Pair(2, static_cast<double>(140)))
+                    .add(Pair(3, static_cast<long>(3))));
+
+        if (any.received != 3 || all_data.received != 2 ||
+            normal_data.received != 1 || low_geared.received != 1)
+        {
+            std::printf("routing test failed\n");
+            return -1;
+        }
+
+        if (!normal_speed.test(Message(Pair(2, static_cast<float>(0)))) ||
+            low_gear.test(Message(Pair(3, static_cast<float>(1)))))
+        {
+            std::printf("condition test failed\n");
+            return -1;
+        }
+
+        for (int round = 0; round < 2; ++round)
+        {
+            Bus other;
+            test_counter counter;
+            counter.when(data, 1);
+            other.reg(counter);
+            other.send(Message(Pair(1, static_cast<int>(round == 0 ? 2 : 1))));
+
+            if (counter.received != (round == 0 ? 1 : 0))
+            {
+                std::printf("condition stamp test failed\n");
+                return -1;
+            }
+        }
+    }
+
+    {
+        // This test checks the unsigned conditions: the values above the
+        // range of long match, the negative ones never do.
+
+        const unsigned long big = static_cast<unsigned long>(-1) - 1;
+        const Condition exact(1, big);
+        const Condition small(1, 5u);
+        const Condition range(1, 2u, 7u);
+
+        if (!exact.test(Message(Pair(1, big))) ||
+            exact.test(Message(Pair(1, static_cast<long>(-2)))) ||
+            !small.test(Message(Pair(1, static_cast<char>(5)))) ||
+            !range.test(Message(Pair(1, static_cast<int>(7)))) ||
+            range.test(Message(Pair(1, static_cast<int>(-3)))) ||
+            range.test(Message(Pair(1, static_cast<unsigned long>(8)))))
+        {
+            std::printf("unsigned condition test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the routing index: the groups of the different
+        // guards and the plain handlers are merged in the order of
+        // registration, with more groups than the send merges too, and the
+        // changed or shared guards route the same as before.
+
+        const Condition* guard[12];
+        Condition* owned[12];
+        for (int i = 0; i < 12; ++i)
+        {
+            owned[i] = i % 2 == 0 ? new Condition(1, 2) :
+                                    new Condition(1, 2, 3);
+            guard[i] = owned[i];
+        }
+
+        int log[32];
+        std::size_t size = 0;
+        test_orderer handlers[12];
+        Bus bus;
+        for (int i = 0; i < 12; ++i)
+        {
+            handlers[i].id = i;
+            handlers[i].log = log;
+            handlers[i].size = &size;
+            if (i % 3 != 0) { handlers[i].when(&guard[i % 4], 1); }
+            bus.reg(handlers[i]);
+        }
+
+        bus.send(Message(Pair(1, static_cast<int>(3))));
+
+        const int expected[] = { 0, 1, 3, 5, 6, 7, 9, 11 };
+        bool ordered = size == 8;
+        for (std::size_t i = 0; ordered && i < size; ++i)
+        {
+            ordered = log[i] == expected[i];
+        }
+        if (!ordered)
+        {
+            std::printf("routing order test failed\n");
+            return -1;
+        }
+
+        for (int i = 0; i < 12; ++i) { handlers[i].when(&guard[i], 1); }
+        size = 0;
+        bus.send(Message(Pair(1, static_cast<int>(2))));
+        bus.send(Message(Pair(1, static_cast<int>(3))));
+
+        ordered = size == 18;
+        for (std::size_t i = 0; ordered && i < size; ++i)
+        {
+            ordered = log[i] == (i < 12 ? static_cast<int>(i) :
+                                 static_cast<int>(i - 12) * 2 + 1);
+        }
+        if (!ordered)
+        {
+            std::printf("routing overflow test failed\n");
+            return -1;
+        }
+
+        Bus other;
+        test_orderer shared;
+        shared.id = 20;
+        shared.log = log;
+        shared.size = &size;
+        shared.when(&guard[0], 1);
+        other.reg(shared);
+        size = 0;
+        other.send(Message(Pair(1, static_cast<int>(2))));
+        other.send(Message(Pair(1, static_cast<int>(3))));
+        other.unreg(shared);
+
+        test_orderer late;
+        late.id = 30;
+        late.log = log;
+        late.size = &size;
+        late.when(&guard[1], 1);
+        test_registrar registrar(bus, late, 3);
+        bus.reg(registrar);
+        bus.send(Message(Pair(1, static_cast<int>(3))));
+
+        if (size != 8 || log[0] != 20 || log[7] != 30)
+        {
+            std::printf("routing registration test failed\n");
+            return -1;
+        }
+
+        bus.unreg(late);
+        bus.unreg(registrar);
+        for (int i = 0; i < 12; ++i)
+        {
+            bus.unreg(handlers[i]);
+            delete owned[i];
+        }
+    }
+
+    {
+        // This test checks the sticky messages: the handler registered late
+        // receives the last state right away, other messages are not kept.
+
+        Bus bus;
+        StickyMessage<2> state(1);
+        bus.stick(state);
+
+        bus.send(Message(Pair(1, static_cast<int>(5))));
+        bus.send(Message(Pair(1, static_cast<int>(7)))
+                    .add(Pair(2, static_cast<int>(8)))
+                    .add(Pair(3, static_cast<int>(9))));
+        bus.send(Message(Pair(2, static_cast<int>(3))));
+
+        test_consumer late;
+        bus.reg(late);
+
+        if (state.empty() || late.received != 7)
+        {
+            std::printf("sticky snapshot test failed\n");
+            return -1;
+        }
+
+        bus.send(Message(Pair(1, static_cast<int>(11))));
+
+        test_consumer later;
+        bus.reg(later);
+
+        if (later.received != 11 || late.received != 11)
+        {
+            std::printf("sticky update test failed\n");
+            return -1;
+        }
+
+        Bus other;
+        bus.stick(state);
+        other.stick(state);
+        other.send(Message(Pair(1, static_cast<int>(13))));
+
+        test_consumer again;
+        bus.reg(again);
+
+        if (again.received != 11)
+        {
+            std::printf("sticky attach test failed\n");
+            return -1;
+        }
+
+        StickyMessage<2> tail(1);
+        other.stick(tail);
+        other.send(Message(Pair(2, static_cast<int>(3)))
+                    .add(Pair(3, static_cast<int>(4)))
+                    .add(Pair(1, static_cast<int>(15))));
+
+        test_consumer last;
+        other.reg(last);
+
+        if (!tail.truncated() || last.received != 15 || state.truncated())
+        {
+            std::printf("sticky truncation test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the sticky payload: the kept message holds the
+        // buffer after the sender's payload is gone, until the next update.
+
+        static const char frame[] = "frame";
+        int released = 0;
+        Owner owner(reinterpret_cast<void*>(&released), test_release);
+
+        Bus bus;
+        StickyMessage<1> state(1);
+        bus.stick(state);
+
+        {
+            Payload payload(frame, sizeof(frame), &owner);
+            bus.send(Message(Pair(1, payload)));
+        }
+
+        test_keeper late;
+        bus.reg(late);
+
+        if (released != 0 || late.kept.data() != frame)
+        {
+            std::printf("sticky payload test failed\n");
+            return -1;
+        }
+
+        late.kept = Payload();
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+
+        if (released != 1)
+        {
+            std::printf("sticky payload release test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the sticky lifetime: the handler registered
+        // during the send gets the previous state and then the message being
+        // sent, once, and the destroyed storage is detached from the bus.
+
+        Bus bus;
+        StickyMessage<1> state(1);
+        bus.stick(state);
+        bus.send(Message(Pair(1, static_cast<int>(5))));
+
+        test_adder adder;
+        test_registrar registrar(bus, adder, 7);
+        bus.reg(registrar);
+        bus.send(Message(Pair(1, static_cast<int>(7))));
+
+        if (adder.sum != 12)
+        {
+            std::printf("sticky registration during send test failed\n");
+            return -1;
+        }
+
+        {
+            StickyMessage<2> scoped(1);
+            bus.stick(scoped);
+        }
+        bus.send(Message(Pair(1, static_cast<int>(9))));
+
+        bus.unstick(state);
+        bus.send(Message(Pair(1, static_cast<int>(11))));
+
+        test_consumer late;
+        bus.reg(late);
+
+        if (late.received != 0 || adder.sum != 32)
+        {
+            std::printf("sticky detach test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the unregistration: from the other handler and
+        // from itself during the send, and by the handler's destructor.
+
+        Bus bus;
+        test_remover remover(bus);
+        test_counter removed;
+        test_counter kept;
+        test_remover self(bus);
+        remover.target = &removed;
+
+        bus.reg(remover);
+        bus.reg(removed);
+        bus.reg(kept);
+        bus.reg(self);
+        bus.reg(kept);
+
+        {
+            test_counter scoped;
+            bus.reg(scoped);
+        }
+
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+
+        if (removed.received != 0 || kept.received != 2 ||
+            self.received != 1 || remover.received != 2)
+        {
+            std::printf("unreg test failed\n");
+            return -1;
+        }
+
+        bus.unreg(remover);
+        bus.reg(removed);
+        bus.send(Message(Pair(1, static_cast<int>(1))));
+
+        if (removed.received != 1 || kept.received != 3 ||
+            remover.received != 2)
+        {
+            std::printf("reg after unreg test failed\n");
+            return -1;
+        }
+    }
+
+    {
+        // This test checks the named keys: the same name declared twice is
+        // the same key, the other name with the same value is the collision.
+
+        const Key speed("vehicle.speed");
+        const Key speed_again("vehicle.speed");
+        const Key legacy("vehicle.rpm", 3);
+
+        if (hash_key("foobar") != 0xBF9CF968UL || hash_key("") != 0x811C9DC5UL)
+        {
+            std::printf("key hash test failed\n");
+            return -1;
+        }
+
+        if (speed != hash_key("vehicle.speed") || speed != speed_again ||
+            Key::collision() != static_cast<const Key*>(0) ||
+            std::strcmp(Key::lookup(speed), "vehicle.speed") != 0 ||
+            Key::lookup(3) != legacy.name())
+        {
+            std::printf("key registry test failed\n");
+            return -1;
+        }
+
+        Pair speed_pair(speed, static_cast<float>(40));
+        Message mess(speed_pair);
+        if (mess.get_float(speed_again) != static_cast<float>(40))
+        {
+            std::printf("key lookup test failed\n");
+            return -1;
+        }
+
+        {
+            const Key gear("vehicle.gear", 3);
+            if (Key::collision() != &gear)
+            {
+                std::printf("key collision test failed\n");
+                return -1;
+            }
+        }
+
+        if (Key::collision() != static_cast<const Key*>(0))
+        {
+            std::printf("key unregistration test failed\n");
+            return -1;
+        }
+    }
+
     return 0;
 }
\ No newline at end of file